@@ -0,0 +1,70 @@
+#include <string>
+#include <string_view>
+
+#include <klogger/klogger.hpp>
+
+void example1(void);
+void example2(void);
+
+/*
+    C++ front end, format is checked during compilation
+
+    Log on stderr only
+    Enable levels <= DEBUG
+
+    Output:
+    [INFO    ] example/cpp/main.cpp:28 example1: Request 42 from kukos took 1.5 ms
+    [WARNING ] example/cpp/main.cpp:29 example1: Retry true, state 2, name {kukos}
+    [DEBUG   ] example/cpp/main.cpp:30 example1: Mixed with C style macro 42
+*/
+void example1(void)
+{
+    klogger_init(-1, KLOGGER_LEVEL_DEBUG, KLOGGER_OPTIONS_STDERR_DUPLICATE);
+
+    enum class State { IDLE, BUSY, DONE };
+    const std::string user = "kukos";
+    const unsigned id = 42;
+
+    KLOGPP_INFO("Request {} from {} took {} ms", id, user, 1.5);
+    KLOGPP_WARNING("Retry {}, state {}, name {{{}}}", true, State::DONE, std::string_view(user));
+    KLOG_DEBUG("Mixed with C style macro %u", id);
+
+    /* Those lines do not compile: wrong number of arguments and unmatched brace */
+    /* KLOGPP_INFO("Request {} from {}", id); */
+    /* KLOGPP_INFO("Request { from {}", user); */
+
+    klogger_deinit();
+}
+
+/*
+    Spans work in C++ too
+
+    Log on stderr only
+    Enable levels <= DEBUG
+
+    Output:
+    [DEBUG   ] example/cpp/main.cpp:55 example2: loop took 3.151 us
+    [INFO    ] example/cpp/main.cpp:59 example2: Sum 4950
+*/
+void example2(void)
+{
+    klogger_init(-1, KLOGGER_LEVEL_DEBUG, KLOGGER_OPTIONS_STDERR_DUPLICATE);
+
+    unsigned long sum = 0;
+    {
+        KLOG_SCOPE(KLOGGER_LEVEL_DEBUG, "loop");
+        for (unsigned i = 0; i < 100; ++i)
+            sum += i;
+    }
+    KLOGPP_INFO("Sum {}", sum);
+
+    klogger_deinit();
+}
+
+int main(void)
+{
+    example1();
+    example2();
+
+    return 0;
+}
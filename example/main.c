@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <sys/wait.h>
 
 #include <klogger/klogger.h>
 
@@ -11,6 +12,9 @@ void example1(void);
 void example2(void);
 void example3(void);
 void example4(void);
+void example5(void);
+void example6(void);
+void example7(void);
 
 /*
     Log on stderr + auto file
@@ -185,11 +189,117 @@ void example4(void)
     }
 }
 
+/*
+    Pre-forked workers log into one collector
+
+    Log on stderr + auto file (only one file for all processes)
+    Get timestamp + PID + TID
+    Enable levels <= INFO
+
+    Output:
+    [INFO    ] [12:14:02.120113] [PID: 792001] [TID: 792001] example/main.c:213 example5: Worker 0 started
+    [INFO    ] [12:14:02.120140] [PID: 792002] [TID: 792002] example/main.c:213 example5: Worker 1 started
+    [INFO    ] [12:14:02.120171] [PID: 792003] [TID: 792003] example/main.c:213 example5: Worker 2 started
+    [INFO    ] [12:14:02.120492] [PID: 792000] [TID: 792000] example/main.c:224 example5: All workers finished
+*/
+void example5(void)
+{
+    klogger_init(-1, KLOGGER_LEVEL_INFO, KLOGGER_OPTIONS_MULTIPROCESS_DEFAULT);
+
+    const unsigned workers = 3;
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        /* Worker, logger is inherited from collector, do not call init here */
+        if (fork() == 0)
+        {
+            KLOG_INFO("Worker %u started", i);
+            KLOG_DEBUG("Worker %u skipped msg", i);
+
+            klogger_deinit();
+            _exit(0);
+        }
+    }
+
+    for (unsigned i = 0; i < workers; ++i)
+        wait(NULL);
+
+    KLOG_INFO("All workers finished");
+
+    klogger_deinit();
+}
+
+/*
+    Measure time of code with spans, write them also as trace events
+
+    Log on stderr + auto file + trace file (log_name.log.trace.json)
+    Get timestamp
+    Enable levels <= DEBUG
+
+    Output:
+    [DEBUG   ] [12:15:21.512113] example/main.c:250 example6: step took 1062.339 us
+    [DEBUG   ] [12:15:21.514301] example/main.c:250 example6: step took 1058.402 us
+    [INFO    ] [12:15:21.514350] example/main.c:247 example6: example6 took 2189.120 us
+*/
+void example6(void)
+{
+    klogger_init(-1, KLOGGER_LEVEL_DEBUG, KLOGGER_OPTIONS_DEFAULT | KLOGGER_OPTIONS_FILE_TRACE);
+
+    {
+        KLOG_SCOPE(KLOGGER_LEVEL_INFO, "example6");
+        for (unsigned i = 0; i < 2; ++i)
+        {
+            klogger_span_t span = KLOG_SPAN_BEGIN(KLOGGER_LEVEL_DEBUG, "step");
+            usleep(1000);
+            KLOG_SPAN_END(span);
+
+            /* Filtered out by level, costs only level check */
+            KLOG_SCOPE(KLOGGER_LEVEL_DEBUG3, "skipped");
+        }
+    }
+
+    klogger_deinit();
+}
+
+/*
+    Thread local context, request ID and tenant are added to every record without %s
+
+    Log on stderr only
+    Get timestamp + TID
+    Enable levels <= INFO
+
+    Output:
+    [INFO    ] [12:16:40.101532] [TID: 792100] [tenant=kukos request_id=1] example/main.c:286 example7: Request started
+    [INFO    ] [12:16:40.101561] [TID: 792100] [tenant=kukos request_id=2] example/main.c:286 example7: Request started
+    [INFO    ] [12:16:40.101580] [TID: 792100] [tenant=kukos] example/main.c:289 example7: All requests done
+*/
+void example7(void)
+{
+    klogger_init(-1, KLOGGER_LEVEL_INFO, KLOGGER_OPTIONS_STDERR_DUPLICATE | KLOGGER_OPTIONS_USE_TIMESTAMP | KLOGGER_OPTIONS_USE_THREADID);
+
+    klogger_ctx_push("tenant", "kukos");
+    for (unsigned i = 1; i <= 2; ++i)
+    {
+        char request_id[16];
+        snprintf(&request_id[0], sizeof(request_id), "%u", i);
+
+        klogger_ctx_push("request_id", &request_id[0]);
+        KLOG_INFO("Request started");
+        klogger_ctx_pop();
+    }
+    KLOG_INFO("All requests done");
+    klogger_ctx_pop();
+
+    klogger_deinit();
+}
+
 int main(void)
 {
     example1();
     example2();
     example3();
+    example5();
+    example6();
+    example7();
     example4();
 
     return 0;
@@ -0,0 +1,47 @@
+#ifndef KLOGGER_INDEX_H
+#define KLOGGER_INDEX_H
+
+/*
+    This header describes format of the sidecar index file.
+    It is used by KLogger file sink (KLOGGER_OPTIONS_FILE_INDEX) and by klogger-query tool.
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+    LICENCE: GPL3
+
+
+    Index file has the same name as log file with additional ".idx" suffix.
+    File starts with KLogger_index_header, then KLogger_index_entry for every block follows.
+    Block is a continuous range of whole records in log file, closed when it has at least
+    block_size bytes. Last block can be missing in index (logger is still running or crashed),
+    so readers should treat bytes after last block as a block with unknown time and levels.
+
+    Timestamps are in usec since Epoch. last_ts is never smaller than last_ts of previous entry,
+    so readers can binary search entries by last_ts.
+*/
+
+#include <stdint.h>
+
+#define KLOGGER_INDEX_MAGIC      "KLOGIDX"
+#define KLOGGER_INDEX_VERSION    1
+#define KLOGGER_INDEX_SUFFIX     ".idx"
+
+typedef struct KLogger_index_header
+{
+    char magic[8];          /* KLOGGER_INDEX_MAGIC with '\0' */
+    uint32_t version;       /* KLOGGER_INDEX_VERSION */
+    uint32_t entry_size;    /* sizeof(KLogger_index_entry) */
+    uint64_t block_size;    /* minimal size of block in bytes */
+} KLogger_index_header;
+
+typedef struct KLogger_index_entry
+{
+    uint64_t offset;        /* offset of first record in log file */
+    uint64_t size;          /* size of block in bytes */
+    int64_t first_ts;       /* the oldest timestamp in block */
+    int64_t last_ts;        /* the newest timestamp in block (and all previous blocks) */
+    uint32_t levels;        /* bitmap of levels present in block, bit i is set for level i */
+    uint32_t reserved;
+} KLogger_index_entry;
+
+#endif
@@ -18,12 +18,18 @@
 #error "Gnu extension is required to compile code with KLogger!"
 #endif
 
-/* C11 has value 201112L */
-#if __STDC_VERSION__ < 201112L
+/* C11 has value 201112L, C++ code uses the same library (see klogger.hpp) */
+#if !defined(__cplusplus) && __STDC_VERSION__ < 201112L
 #error "At least C11 is required to compile code with KLogger!"
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* Need bitwise operations, so instead of enum use uint32_t + defines like in POSIX */
 typedef uint32_t klogger_option_t;
@@ -32,6 +38,9 @@ typedef uint32_t klogger_option_t;
 #define KLOGGER_PRIV_OPTIONS_FILE_DUPLICATE      (1 << 2)
 #define KLOGGER_PRIV_OPTIONS_USE_TIMESTAMP       (1 << 3)
 #define KLOGGER_PRIV_OPTIONS_USE_THREADID        (1 << 4)
+#define KLOGGER_PRIV_OPTIONS_MULTIPROCESS        (1 << 5)
+#define KLOGGER_PRIV_OPTIONS_FILE_INDEX          (1 << 6)
+#define KLOGGER_PRIV_OPTIONS_FILE_TRACE          (1 << 7)
 
 /* Integer values are critical for this framework functionality, so I decided to hardcode them */
 typedef enum klogger_priv_level
@@ -54,6 +63,14 @@ void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
                                                              const char* fmt,
                                                              ...);
 
+/* Like __klogger_print, but message is already formatted (used by C++ front end) */
+void __klogger_print_raw(const char* file,
+                         const char* func,
+                         int line,
+                         klogger_level_t level,
+                         const char* msg,
+                         size_t msg_size);
+
 #define KLOG_PRIV_GENERAL(LVL, ...) __klogger_print(__FILE__, __func__, __LINE__, LVL, __VA_ARGS__)
 
 #define KLOG_PRIV_FATAL(...)     KLOG_PRIV_GENERAL(KLOGGER_PRIV_LEVEL_FATAL, __VA_ARGS__)
@@ -65,4 +82,84 @@ void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
 #define KLOG_PRIV_DEBUG2(...)    KLOG_PRIV_GENERAL(KLOGGER_PRIV_LEVEL_DEBUG2, __VA_ARGS__)
 #define KLOG_PRIV_DEBUG3(...)    KLOG_PRIV_GENERAL(KLOGGER_PRIV_LEVEL_DEBUG3, __VA_ARGS__)
 
+/* Max level set by klogger_init, -1 when klogger is not inited. Read only, used by inline span code */
+extern int __klogger_level;
+
+typedef struct klogger_span
+{
+    const char* file;
+    const char* func;
+    int line;
+    klogger_level_t level;
+    const char* name;
+    uint64_t start;         /* ticks on begin, 0 when span is disabled by level */
+} klogger_span_t;
+
+/* Cheap monotonic ticks, TSC on x86 (converted to time only on span end), ns on others */
+static inline uint64_t __klogger_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint64_t)__builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void __klogger_span_emit(const klogger_span_t* span, uint64_t end);
+
+static inline klogger_span_t __klogger_span_begin(const char* file,
+                                                  const char* func,
+                                                  int line,
+                                                  klogger_level_t level,
+                                                  const char* name)
+{
+    /* No compound literal, this header is used also by C++ */
+    klogger_span_t span;
+    span.file = file;
+    span.func = func;
+    span.line = line;
+    span.level = level;
+    span.name = name;
+    span.start = (int)level <= __klogger_level ? __klogger_ticks() : 0;
+
+    return span;
+}
+
+/* Span which never ends with record (NDEBUG) */
+static inline klogger_span_t __klogger_span_disabled(void)
+{
+    klogger_span_t span;
+    span.file = NULL;
+    span.func = NULL;
+    span.line = 0;
+    span.level = KLOGGER_PRIV_LEVEL_FATAL;
+    span.name = NULL;
+    span.start = 0;
+
+    return span;
+}
+
+static inline void __klogger_span_end(klogger_span_t* span)
+{
+    if (span->start != 0)
+        __klogger_span_emit(span, __klogger_ticks());
+}
+
+#define KLOG_PRIV_CONCAT_IMPL(a, b) a##b
+#define KLOG_PRIV_CONCAT(a, b)      KLOG_PRIV_CONCAT_IMPL(a, b)
+
+#define KLOG_PRIV_SPAN_BEGIN(LVL, NAME) __klogger_span_begin(__FILE__, __func__, __LINE__, LVL, NAME)
+#define KLOG_PRIV_SPAN_END(SPAN)        __klogger_span_end(&(SPAN))
+
+/* Span ends automatically when variable goes out of scope */
+#define KLOG_PRIV_SCOPE(LVL, NAME) \
+    klogger_span_t KLOG_PRIV_CONCAT(__klogger_scope_, __LINE__) __attribute__(( cleanup(__klogger_span_end) )) = \
+        KLOG_PRIV_SPAN_BEGIN(LVL, NAME)
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
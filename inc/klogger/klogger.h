@@ -14,9 +14,13 @@
 
     Main features:
     - auto file generation + logging into file
+    - optional sidecar index of log file for fast queries (see klogger-query tool)
+    - scoped timing spans, optionally written as Chrome trace events (chrome://tracing, Perfetto)
+    - thread local context (request ID, tags) added to every record of the thread
     - logging on a few descriptors at the same time
     - supporiting any valid decriptor as a main fd (you can send logs via socket)
     - library is full multithread safe, but it requires pthread library
+    - library is fork safe, forked workers can log via shared memory into one collector
     - library can be disbaled to create release version with no additional operation
       just define NDEBUG and KLOGGER_FATAL_SILENT
     - this header contains short description about logger levels, you can follow this style
@@ -89,15 +93,43 @@
  * IF you do not know what you need, use default option
  * or multithread default option if your program has more than 1 thread (or proc)
  *
+ * KLOGGER_OPTIONS_MULTIPROCESS is designed for pre-forked worker pools.
+ * Process which calls klogger_init becomes a collector, it owns all descriptors (and file)
+ * and writes them from a dedicated thread. Processes forked after init put their records
+ * into a shared memory ring, so you get a one merged log file tagged by PID instead of N files.
+ * Do not call klogger_init in forked workers, they inherit the logger from the collector.
+ * FATAL returns when record is written by collector, other levels are written asynchronously.
+ * Collector writes all records from ring on klogger_deinit or on exit (it does not happen on abort).
+ *
+ * KLOGGER_OPTIONS_FILE_INDEX works only with KLOGGER_OPTIONS_FILE_DUPLICATE.
+ * Next to the log file KLogger writes a sidecar index (see klogger-index.h)
+ * with offset, time range and levels of every block of the file.
+ * Use klogger-query tool to search log file with index, instead of grepping whole file.
+ * Index is written only by the process which owns the file. After plain fork (without
+ * KLOGGER_OPTIONS_MULTIPROCESS) parent and child share the file, so index ends at the fork
+ * and the rest of file is scanned by klogger-query as not indexed tail.
+ *
+ * KLOGGER_OPTIONS_FILE_TRACE works only with KLOGGER_OPTIONS_FILE_DUPLICATE.
+ * Next to the log file KLogger writes spans (see KLOG_SCOPE) as Chrome trace events in JSON,
+ * file can be loaded directly by chrome://tracing or Perfetto UI.
+ *
  */
 #define KLOGGER_OPTIONS_STDOUT_DUPLICATE     KLOGGER_PRIV_OPTIONS_STDOUT_DUPLICATE
 #define KLOGGER_OPTIONS_STDERR_DUPLICATE     KLOGGER_PRIV_OPTIONS_STDERR_DUPLICATE
 #define KLOGGER_OPTIONS_FILE_DUPLICATE       KLOGGER_PRIV_OPTIONS_FILE_DUPLICATE
 #define KLOGGER_OPTIONS_USE_TIMESTAMP        KLOGGER_PRIV_OPTIONS_USE_TIMESTAMP
 #define KLOGGER_OPTIONS_USE_THREADID         KLOGGER_PRIV_OPTIONS_USE_THREADID
+#define KLOGGER_OPTIONS_MULTIPROCESS         KLOGGER_PRIV_OPTIONS_MULTIPROCESS
+#define KLOGGER_OPTIONS_FILE_INDEX           KLOGGER_PRIV_OPTIONS_FILE_INDEX
+#define KLOGGER_OPTIONS_FILE_TRACE           KLOGGER_PRIV_OPTIONS_FILE_TRACE
 
 #define KLOGGER_OPTIONS_DEFAULT              (KLOGGER_OPTIONS_STDERR_DUPLICATE | KLOGGER_OPTIONS_FILE_DUPLICATE | KLOGGER_OPTIONS_USE_TIMESTAMP)
 #define KLOGGER_OPTIONS_MULTITHREAD_DEFAULT  (KLOGGER_OPTIONS_DEFAULT | KLOGGER_OPTIONS_USE_THREADID)
+#define KLOGGER_OPTIONS_MULTIPROCESS_DEFAULT (KLOGGER_OPTIONS_MULTITHREAD_DEFAULT | KLOGGER_OPTIONS_MULTIPROCESS)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * This function initializes klogger. Shall be call only once before any othe klogger functions.
@@ -122,9 +154,37 @@ int klogger_init(int fd, klogger_level_t level, klogger_option_t options);
 
 /**
  * This function will destroy all klogger private data. Call only once after init and use
+ * In KLOGGER_OPTIONS_MULTIPROCESS mode collector flushes all pending records from workers,
+ * so call it in collector after workers have finished. Worker only detaches from shared memory.
  */
 void klogger_deinit(void);
 
+/**
+ * Context is a list of key=value pairs of the calling thread (i.e. request ID, tenant).
+ * Every record logged by this thread gets the context after TID: [key1=value1 key2=value2]
+ * and every trace event gets the context as args. Context is rendered only on push and pop,
+ * so logging with context costs one memcpy.
+ *
+ * Context works like a stack, pop removes the last pushed pair.
+ * Key and value are copied, so they can be freed after push. Control characters (i.e new line) are skipped.
+ * Thread can keep at most 16 pairs, 512 bytes for all keys and values.
+ *
+ * @param[in] key     - name of field
+ * @param[in] value   - value of field
+ *
+ * @return 0 on success, non-zero value on fail (no space for context)
+ */
+int klogger_ctx_push(const char* key, const char* value);
+
+/**
+ * This function removes the last pushed context pair of the calling thread.
+ */
+void klogger_ctx_pop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 /**
  * NDEBUG like in case of assert can change code into full release version without any logging
  * Please note that to suppress KLOG_FATAL you need to define also KLOGGER_FATAL_SILENT
@@ -146,6 +206,27 @@ void klogger_deinit(void);
 #define KLOG_DEBUG2(...)    KLOG_PRIV_DEBUG2(__VA_ARGS__)
 #define KLOG_DEBUG3(...)    KLOG_PRIV_DEBUG3(__VA_ARGS__)
 
+/**
+ * Use this macros to measure time of your code.
+ *
+ * KLOG_SCOPE(LVL, NAME) starts a span and ends it when current scope ends,
+ * then one record with duration is logged on level LVL.
+ * KLOG_SPAN_BEGIN / KLOG_SPAN_END do the same, but you decide where span ends.
+ *
+ * When LVL is filtered out span costs only one level check, otherwise one TSC read on begin.
+ * With KLOGGER_OPTIONS_FILE_TRACE span is also written as trace event.
+ *
+ * Example:
+ * KLOG_SCOPE(KLOGGER_LEVEL_DEBUG, "parse");
+ *
+ * klogger_span_t span = KLOG_SPAN_BEGIN(KLOGGER_LEVEL_DEBUG, "send");
+ * send(...);
+ * KLOG_SPAN_END(span);
+ */
+#define KLOG_SCOPE(LVL, NAME)       KLOG_PRIV_SCOPE(LVL, NAME)
+#define KLOG_SPAN_BEGIN(LVL, NAME)  KLOG_PRIV_SPAN_BEGIN(LVL, NAME)
+#define KLOG_SPAN_END(SPAN)         KLOG_PRIV_SPAN_END(SPAN)
+
 #else /* #ifndef NDEBUG */
 
 /* KLOG_FATAL needs another define */
@@ -167,6 +248,10 @@ void klogger_deinit(void);
 #define KLOG_DEBUG2(...)
 #define KLOG_DEBUG3(...)
 
+#define KLOG_SCOPE(LVL, NAME)
+#define KLOG_SPAN_BEGIN(LVL, NAME)  __klogger_span_disabled()
+#define KLOG_SPAN_END(SPAN)         ((void)(SPAN))
+
 #endif /* #ifndef NDEBUG */
 
 #endif /* include guard */
@@ -0,0 +1,332 @@
+#ifndef KLOGGER_HPP
+#define KLOGGER_HPP
+
+/*
+    This is the C++ front end of the KLogger, in C++ code include this header instead of klogger.h
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+    LICENCE: GPL3
+
+
+    Front end is header only, it uses the same C library (init, deinit, options, sinks).
+    KLOGPP_* macros work like KLOG_* macros, but instead of printf format they use {} placeholders:
+
+    KLOGPP_INFO("Request {} from {} took {} ms", id, user_name, time);
+
+    - format string is parsed at compile time, runtime only copies ready chunks
+    - wrong number of arguments or unmatched brace is a compile error
+    - every argument is written by writer for its type, unsupported type is a compile error
+    - {{ and }} are written as { and }
+    - message is built in thread local buffer (64KiB, longer messages are truncated)
+      and passed to the C core which adds header (level, time, ...) and writes it
+
+    Supported types: bool, char, integers, floating points, enums, C strings,
+    std::string, std::string_view, pointers and nullptr.
+*/
+
+#if !defined(__cplusplus) || __cplusplus < 202002L
+#error "At least C++20 is required to compile code with klogger.hpp!"
+#endif
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "klogger.h"
+
+namespace klogger
+{
+namespace detail
+{
+
+/* Those functions are not constexpr, calling them during compile time parsing gives compile error with their names */
+inline void format_error_wrong_number_of_arguments() {}
+inline void format_error_unmatched_brace() {}
+
+/* Thread local buffer for message, it is never bigger than capacity (data is truncated) */
+class buffer
+{
+public:
+    static constexpr std::size_t capacity = 1 << 16;
+
+    void clear() noexcept { size_ = 0; }
+
+    void append(const char* data, std::size_t size) noexcept
+    {
+        const std::size_t to_copy = size < capacity - size_ ? size : capacity - size_;
+        std::memcpy(&data_[size_], data, to_copy);
+        size_ += to_copy;
+    }
+
+    /* Chunk with {{ or }}, write only one char from every pair */
+    void append_unescaped(const char* data, std::size_t size) noexcept
+    {
+        for (std::size_t i = 0; i < size && size_ < capacity; ++i)
+        {
+            data_[size_++] = data[i];
+            if ((data[i] == '{' || data[i] == '}') && i + 1 < size && data[i + 1] == data[i])
+                ++i;
+        }
+    }
+
+    const char* data() const noexcept { return &data_[0]; }
+    std::size_t size() const noexcept { return size_; }
+
+private:
+    std::array<char, capacity> data_;
+    std::size_t size_ = 0;
+};
+
+inline buffer& thread_buffer() noexcept
+{
+    thread_local buffer buf;
+    return buf;
+}
+
+/* Writers for each supported type, type without writer cannot be logged */
+template <typename T>
+struct writer;
+
+template <>
+struct writer<bool>
+{
+    static void write(buffer& buf, bool value) noexcept
+    {
+        if (value)
+            buf.append("true", 4);
+        else
+            buf.append("false", 5);
+    }
+};
+
+template <>
+struct writer<char>
+{
+    static void write(buffer& buf, char value) noexcept
+    {
+        buf.append(&value, 1);
+    }
+};
+
+template <typename T>
+requires (std::integral<T> && !std::same_as<T, bool> && !std::same_as<T, char>)
+struct writer<T>
+{
+    static void write(buffer& buf, T value) noexcept
+    {
+        char str[32];
+        const auto result = std::to_chars(&str[0], &str[sizeof(str)], value);
+        buf.append(&str[0], static_cast<std::size_t>(result.ptr - &str[0]));
+    }
+};
+
+template <std::floating_point T>
+struct writer<T>
+{
+    static void write(buffer& buf, T value) noexcept
+    {
+        char str[64];
+        const auto result = std::to_chars(&str[0], &str[sizeof(str)], value);
+        buf.append(&str[0], static_cast<std::size_t>(result.ptr - &str[0]));
+    }
+};
+
+template <typename T>
+requires std::is_enum_v<T>
+struct writer<T>
+{
+    static void write(buffer& buf, T value) noexcept
+    {
+        writer<std::underlying_type_t<T>>::write(buf, static_cast<std::underlying_type_t<T>>(value));
+    }
+};
+
+/* std::string, std::string_view, char arrays (string literals), nullptr has its own writer */
+template <typename T>
+requires (!std::is_pointer_v<T> && !std::is_null_pointer_v<T> && std::is_convertible_v<const T&, std::string_view>)
+struct writer<T>
+{
+    static void write(buffer& buf, const T& value) noexcept
+    {
+        const std::string_view str = value;
+        buf.append(str.data(), str.size());
+    }
+};
+
+template <>
+struct writer<std::nullptr_t>
+{
+    static void write(buffer& buf, std::nullptr_t) noexcept
+    {
+        buf.append("(null)", 6);
+    }
+};
+
+template <typename T>
+requires (std::is_pointer_v<T> && std::same_as<std::remove_cv_t<std::remove_pointer_t<T>>, char>)
+struct writer<T>
+{
+    static void write(buffer& buf, T value) noexcept
+    {
+        if (value == nullptr)
+            buf.append("(null)", 6);
+        else
+            buf.append(value, std::strlen(value));
+    }
+};
+
+template <typename T>
+requires (std::is_pointer_v<T> && !std::same_as<std::remove_cv_t<std::remove_pointer_t<T>>, char>)
+struct writer<T>
+{
+    static void write(buffer& buf, T value) noexcept
+    {
+        char str[32] = {'0', 'x'};
+        const auto result = std::to_chars(&str[2], &str[sizeof(str)], reinterpret_cast<std::uintptr_t>(value), 16);
+        buf.append(&str[0], static_cast<std::size_t>(result.ptr - &str[0]));
+    }
+};
+
+template <typename T>
+concept writable = requires(buffer& buf, const T& value) { writer<T>::write(buf, value); };
+
+/* Part of format string between placeholders */
+struct chunk
+{
+    std::size_t offset;
+    std::size_t size;
+    bool escaped;           /* chunk has {{ or }} */
+};
+
+/* Format string parsed during compilation, can be created only from string literal */
+template <typename... Args>
+class format_string
+{
+public:
+    template <std::size_t N>
+    consteval format_string(const char (&fmt)[N]) : fmt_(fmt)
+    {
+        const std::size_t size = N - 1;
+        std::size_t args = 0;
+        std::size_t chunk_start = 0;
+        bool escaped = false;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (fmt[i] == '{' && i + 1 < size && fmt[i + 1] == '}')
+            {
+                if (args == sizeof...(Args))
+                    format_error_wrong_number_of_arguments();
+
+                chunks_[args++] = chunk{chunk_start, i - chunk_start, escaped};
+                chunk_start = i + 2;
+                escaped = false;
+                ++i;
+            }
+            else if ((fmt[i] == '{' || fmt[i] == '}') && i + 1 < size && fmt[i + 1] == fmt[i])
+            {
+                escaped = true;
+                ++i;
+            }
+            else if (fmt[i] == '{' || fmt[i] == '}')
+            {
+                format_error_unmatched_brace();
+            }
+        }
+
+        if (args != sizeof...(Args))
+            format_error_wrong_number_of_arguments();
+
+        chunks_[args] = chunk{chunk_start, size - chunk_start, escaped};
+    }
+
+    void write_chunk(buffer& buf, std::size_t i) const noexcept
+    {
+        if (chunks_[i].escaped)
+            buf.append_unescaped(&fmt_[chunks_[i].offset], chunks_[i].size);
+        else
+            buf.append(&fmt_[chunks_[i].offset], chunks_[i].size);
+    }
+
+private:
+    const char* fmt_;
+    std::array<chunk, sizeof...(Args) + 1> chunks_{};   /* chunk before every argument + last one */
+};
+
+template <typename... Args>
+void print(const char* file,
+           const char* func,
+           int line,
+           klogger_level_t level,
+           format_string<std::type_identity_t<Args>...> fmt,
+           const Args&... args)
+{
+    static_assert((writable<std::remove_cvref_t<Args>> && ...), "KLogger: type of argument is not supported");
+
+    /* Skip formatting when level is filtered out. Not inited logger is reported by C core */
+    if (__klogger_level != -1 && static_cast<int>(level) > __klogger_level)
+        return;
+
+    buffer& buf = thread_buffer();
+    buf.clear();
+
+    std::size_t i = 0;
+    fmt.write_chunk(buf, i);
+    ((writer<std::remove_cvref_t<Args>>::write(buf, args), fmt.write_chunk(buf, ++i)), ...);
+
+    __klogger_print_raw(file, func, line, level, buf.data(), buf.size());
+}
+
+} /* namespace detail */
+} /* namespace klogger */
+
+#define KLOGPP_PRIV_GENERAL(LVL, FMT, ...) \
+    ::klogger::detail::print(__FILE__, __func__, __LINE__, LVL, FMT __VA_OPT__(,) __VA_ARGS__)
+
+/**
+ * NDEBUG and KLOGGER_FATAL_SILENT work like in case of KLOG_* macros
+ */
+#ifndef NDEBUG
+/**
+ * Use this macros to log your messages from C++ code.
+ * Those macros works like KLOG_* macros, but use {} as a placeholder for every argument
+ */
+#define KLOGPP_FATAL(...)     KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_FATAL, __VA_ARGS__)
+#define KLOGPP_CRITICAL(...)  KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_CRITICAL, __VA_ARGS__)
+#define KLOGPP_ERROR(...)     KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_ERROR, __VA_ARGS__)
+#define KLOGPP_WARNING(...)   KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_WARNING, __VA_ARGS__)
+#define KLOGPP_INFO(...)      KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_INFO, __VA_ARGS__)
+#define KLOGPP_DEBUG(...)     KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_DEBUG, __VA_ARGS__)
+#define KLOGPP_DEBUG2(...)    KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_DEBUG2, __VA_ARGS__)
+#define KLOGPP_DEBUG3(...)    KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_DEBUG3, __VA_ARGS__)
+
+#else /* #ifndef NDEBUG */
+
+/* KLOGPP_FATAL needs another define */
+#ifndef KLOGGER_FATAL_SILENT
+
+#define KLOGPP_FATAL(...) KLOGPP_PRIV_GENERAL(KLOGGER_LEVEL_FATAL, __VA_ARGS__)
+
+#else /* #ifndef KLOGGER_FATAL_SILENT */
+
+#define KLOGPP_FATAL(...)
+
+#endif /* #ifndef KLOGGER_FATAL_SILENT */
+
+#define KLOGPP_CRITICAL(...)
+#define KLOGPP_ERROR(...)
+#define KLOGPP_WARNING(...)
+#define KLOGPP_INFO(...)
+#define KLOGPP_DEBUG(...)
+#define KLOGPP_DEBUG2(...)
+#define KLOGPP_DEBUG3(...)
+
+#endif /* #ifndef NDEBUG */
+
+#endif /* include guard */
@@ -10,11 +10,25 @@
 #include <stdarg.h>
 #include <execinfo.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <linux/futex.h>
+#include <limits.h>
 
 #include <klogger/klogger.h>
+#include <klogger/klogger-index.h>
 
 #define CALLSTACK_SIZE_MAX 256
 
+/* Index entry is written when block has at least this size, can be changed during lib compilation */
+#ifndef KLOGGER_INDEX_BLOCK_SIZE
+#define KLOGGER_INDEX_BLOCK_SIZE (64 << 10)
+#endif
+
+/* Trace event has 3 strings, each at most this long, so event always fits into 4KiB buffer */
+#define KLOGGER_TRACE_STRING_MAX 1024
+
 typedef struct KLogger_useroptions
 {
     bool stdout_dup:1;      /* Log on stdout or not */
@@ -22,10 +36,46 @@ typedef struct KLogger_useroptions
     bool file_dup:1;        /* Create auto named file and log into it or not */
     bool timestamp:1;       /* Print Time or not */
     bool multithreading:1;  /* Print TID or not */
+    bool multiprocess:1;    /* Log via shared memory ring into collector (+ print PID) or not */
+    bool file_index:1;      /* Write sidecar index for auto file or not */
+    bool file_trace:1;      /* Write spans as trace events next to auto file or not */
 
     klogger_level_t level;  /* Log only levels <= this level, others are skipped */
 } KLogger_useroptions;
 
+/*
+    Ring shared by collector and all forked workers (MAP_SHARED survives fork).
+    Each record is stored as KLogger_record_header + bytes, so collector writes whole records.
+    Worker can be killed at any moment, so it cannot break the ring for others:
+    - mutex is robust, lock held by dead worker is recovered
+    - head and used are published only after whole record is copied, so there is no half of record in ring
+    - waiting is done on futex words instead of process shared condvars, dead waiter leaves no state behind
+*/
+#define KLOGGER_SHM_RING_SIZE (1 << 22)
+typedef struct KLogger_record_header
+{
+    uint32_t size;           /* record size in bytes (without header) */
+    uint32_t level;          /* klogger_level_t of record */
+    int64_t timestamp;       /* usec since Epoch, needed by file index */
+} KLogger_record_header;
+
+typedef struct KLogger_shm_ring
+{
+    pthread_mutex_t mutex;   /* process shared mutex, protects everything below */
+    uint32_t pushed;         /* futex word changed on every push, collector waits here for records */
+    uint32_t popped;         /* futex word changed on every pop, workers wait here for free space */
+    uint32_t pushed_waiters; /* waiters on pushed (can be too big after killed waiter, it costs only a syscall) */
+    uint32_t popped_waiters; /* waiters on popped */
+    uint32_t records;        /* number of pushed records */
+    uint32_t written;        /* futex word, number of records written by collector, FATAL waits here for its record */
+    uint32_t written_waiters;/* waiters on written */
+    size_t head;             /* write position */
+    size_t tail;             /* read position */
+    size_t used;             /* bytes used in data */
+    bool stop;               /* collector is going to finish, drop new records */
+    char data[KLOGGER_SHM_RING_SIZE];
+} KLogger_shm_ring;
+
 #define KLOGGER_DATA_MAX_FD (4) /* main fd + stdout dup + stderr dup + file */
 typedef struct KLogger_data
 {
@@ -35,9 +85,44 @@ typedef struct KLogger_data
     const char* directory;       /* directory name with path (not absolute) */
     mtx_t mutex;                 /* Main mutex to make this logger threadsafe */
     KLogger_useroptions options; /* User options parsed from  klogger_level_t and klogger_option_t */
+    KLogger_shm_ring* ring;      /* Shared ring used only in multiprocess mode */
+    pid_t collector_pid;         /* Process which owns descriptors and collector thread */
+    thrd_t collector;            /* Collector thread, exists only in collector process */
+    int index_fd;                /* sidecar index of auto file (-1 if unused) */
+    uint64_t file_offset;        /* bytes written into auto file, offset of next record */
+    KLogger_index_entry block;   /* index entry of currently written block */
+    int trace_fd;                /* trace events file next to auto file (-1 if unused) */
+    pid_t init_pid;              /* Process which called init, only this one finishes trace file */
+    uint64_t ticks_ref;          /* ticks on init, to convert span ticks into time */
+    int64_t ns_ref;              /* CLOCK_MONOTONIC ns on init */
 } KLogger_data;
 static KLogger_data klogger_priv_data;
 
+int __klogger_level = -1;
+
+/*
+    Thread local context (klogger_ctx_push / klogger_ctx_pop).
+    Keys and values are stored one by one in pool as "key\0value\0", so pop only moves pool_used back.
+    Prefix for records and JSON fields for trace are rendered only when context changes.
+*/
+#define KLOGGER_CTX_MAX          16
+#define KLOGGER_CTX_POOL_SIZE    512
+typedef struct KLogger_ctx
+{
+    size_t entries;                                  /* number of pushed key/value pairs */
+    size_t entry_offset[KLOGGER_CTX_MAX];            /* offset of key in pool */
+    char pool[KLOGGER_CTX_POOL_SIZE];
+    size_t pool_used;
+    char prefix[KLOGGER_CTX_POOL_SIZE + 4];          /* "[k1=v1 k2=v2] ", \0 of pairs are replaced by = and space */
+    size_t prefix_size;
+    char json[2 * KLOGGER_CTX_POOL_SIZE + 6 * KLOGGER_CTX_MAX];  /* ,"k1":"v1","k2":"v2" (escaped) */
+    size_t json_size;
+} KLogger_ctx;
+static thread_local KLogger_ctx klogger_priv_ctx;
+
+/* klogger is thread safe (buffer is used only under mutex), so we can use static buffer here */
+static char klogger_priv_buffer[1 << 20];
+
 /* Keep it in proper order with alignment to biggest one */
 static const char* klogger_priv_level_string[] = {"FATAL   ",
                                                   "CRITICAL",
@@ -51,11 +136,72 @@ static const char* klogger_priv_level_string[] = {"FATAL   ",
 
 static KLogger_useroptions __klogger_parse_useroptions(int fd, klogger_level_t lvl, klogger_option_t options);
 
+/*
+    Record is built in klogger_priv_buffer: lock (false if record is skipped), begin (header),
+    message is added by caller, end (new line, stacktrace, write and unlock)
+*/
+static bool __klogger_record_lock(klogger_level_t level);
+static size_t __klogger_record_begin(char* buffer,
+                                     size_t buffer_size,
+                                     const char* file,
+                                     const char* func,
+                                     int line,
+                                     klogger_level_t level,
+                                     struct timeval* timeval_now);
+static void __klogger_record_end(char* buffer,
+                                 size_t buffer_size,
+                                 size_t buffer_index,
+                                 klogger_level_t level,
+                                 const struct timeval* timeval_now);
+
 /* Write something to buffer, return number of bytes written into buffer */
-static size_t __klogger_write_timestamp(char *buffer, size_t buffer_size);
+static size_t __klogger_write_timestamp(char *buffer, size_t buffer_size, const struct timeval* timeval_now);
 static size_t __klogger_write_tid(char *buffer, size_t buffer_size);
+static size_t __klogger_write_pid(char *buffer, size_t buffer_size);
 static size_t __klogger_write_stacktrace(char *buffer, size_t buffer_size);
 
+/* Write buffer into all valid descriptors */
+static void __klogger_write_fds(const char* buffer, size_t buffer_size);
+
+/* Write record into all valid descriptors and update file index */
+static void __klogger_write_record(const char* record, const KLogger_record_header* header);
+
+/* Sidecar index of auto file */
+static int __klogger_index_create(const char* file_name);
+static void __klogger_index_update(const KLogger_record_header* header);
+static void __klogger_index_flush(void);
+static void __klogger_index_close(void);
+
+/* Trace events file (JSON array format) */
+static int __klogger_trace_create(const char* file_name);
+static void __klogger_trace_finish(void);
+static size_t __klogger_write_json_string(char *buffer, size_t buffer_size, const char* str);
+static int64_t __klogger_monotonic_ns(void);
+
+/* Render prefix and JSON fields of thread local context */
+static void __klogger_ctx_render(KLogger_ctx* ctx);
+static size_t __klogger_write_ctx_string(char *buffer, size_t buffer_size, const char* str);
+
+/* Fork handlers, registered only once via pthread_atfork */
+static void __klogger_atfork_prepare(void);
+static void __klogger_atfork_parent(void);
+static void __klogger_atfork_child(void);
+
+/* Exit handler, registered only once via atexit, drains the ring in collector process */
+static void __klogger_atexit(void);
+
+/* Shared memory ring used in multiprocess mode */
+static KLogger_shm_ring* __klogger_shm_ring_create(void);
+static void __klogger_shm_ring_destroy(KLogger_shm_ring* ring);
+static void __klogger_shm_ring_lock(KLogger_shm_ring* ring);
+static void __klogger_shm_ring_wait(KLogger_shm_ring* ring, uint32_t* word, uint32_t* waiters);
+static void __klogger_shm_ring_wake(uint32_t* word, int waiters);
+static size_t __klogger_shm_ring_copy_in(KLogger_shm_ring* ring, size_t pos, const void* src, size_t size);
+static size_t __klogger_shm_ring_copy_out(KLogger_shm_ring* ring, size_t pos, void* dst, size_t size, size_t dst_size);
+static void __klogger_shm_ring_push(KLogger_shm_ring* ring, const char* record, const KLogger_record_header* header, bool wait_written);
+static bool __klogger_shm_ring_pop(KLogger_shm_ring* ring, char* record, size_t record_size_max, KLogger_record_header* header, uint32_t written);
+static int __klogger_shm_collector(void* arg);
+
 static KLogger_useroptions __klogger_parse_useroptions(int fd, klogger_level_t lvl, klogger_option_t options)
 {
     return (KLogger_useroptions)
@@ -67,24 +213,25 @@ static KLogger_useroptions __klogger_parse_useroptions(int fd, klogger_level_t l
             .stderr_dup      = (options & KLOGGER_OPTIONS_STDERR_DUPLICATE) && fd != 2,
             .file_dup        = options & KLOGGER_OPTIONS_FILE_DUPLICATE,
             .timestamp       = options & KLOGGER_OPTIONS_USE_TIMESTAMP,
-            .multithreading  = options & KLOGGER_OPTIONS_USE_THREADID
+            .multithreading  = options & KLOGGER_OPTIONS_USE_THREADID,
+            .multiprocess    = options & KLOGGER_OPTIONS_MULTIPROCESS,
+            /* Index makes sense only for auto file */
+            .file_index      = (options & KLOGGER_OPTIONS_FILE_INDEX) && (options & KLOGGER_OPTIONS_FILE_DUPLICATE),
+            /* Trace the same, it lives next to auto file */
+            .file_trace      = (options & KLOGGER_OPTIONS_FILE_TRACE) && (options & KLOGGER_OPTIONS_FILE_DUPLICATE)
         };
 }
 
-static size_t __klogger_write_timestamp(char *buffer, size_t buffer_size)
+static size_t __klogger_write_timestamp(char *buffer, size_t buffer_size, const struct timeval* timeval_now)
 {
     size_t bytes_written = 0;
 
-    /* h:min:sec can be obtanined from localtime, but we need a usec too, use gettimeofday */
-    struct timeval timeval_now;
-    gettimeofday(&timeval_now, NULL);
-
-    /* Write h:min:sec */
-    const struct tm tm_time = *localtime(&(time_t){timeval_now.tv_sec});
+    /* Write h:min:sec, usec is not supported by strftime */
+    const struct tm tm_time = *localtime(&(time_t){timeval_now->tv_sec});
     bytes_written += strftime(&buffer[bytes_written], buffer_size - bytes_written, "[%H:%M:%S", &tm_time);
 
     /* add.usec manually */
-    bytes_written += (size_t)snprintf(&buffer[bytes_written], buffer_size - bytes_written, ".%06ld] ", (long)timeval_now.tv_usec);
+    bytes_written += (size_t)snprintf(&buffer[bytes_written], buffer_size - bytes_written, ".%06ld] ", (long)timeval_now->tv_usec);
 
     return bytes_written;
 }
@@ -96,6 +243,11 @@ static size_t __klogger_write_tid(char *buffer, size_t buffer_size)
     return (size_t)snprintf(buffer, buffer_size, "[TID: %ld] ", (long)id);
 }
 
+static size_t __klogger_write_pid(char *buffer, size_t buffer_size)
+{
+    return (size_t)snprintf(buffer, buffer_size, "[PID: %ld] ", (long)getpid());
+}
+
 static size_t __klogger_write_stacktrace(char *buffer, size_t buffer_size)
 {
     size_t bytes_written = 0;
@@ -117,6 +269,455 @@ static size_t __klogger_write_stacktrace(char *buffer, size_t buffer_size)
     return bytes_written;
 }
 
+static void __klogger_write_fds(const char* buffer, size_t buffer_size)
+{
+    for (size_t i = 0; i < KLOGGER_DATA_MAX_FD; ++i)
+    {
+        if (klogger_priv_data.fd[i] <= 0)
+            continue;
+
+        size_t bytes_written = 0;
+        while (bytes_written < buffer_size)
+        {
+            const ssize_t ret = write(klogger_priv_data.fd[i], &buffer[bytes_written], buffer_size - bytes_written);
+            if (ret == -1 && errno == EINTR)
+                continue;
+
+            if (ret <= 0)
+                break;
+
+            bytes_written += (size_t)ret;
+        }
+    }
+}
+
+static void __klogger_write_record(const char* record, const KLogger_record_header* header)
+{
+    __klogger_write_fds(record, header->size);
+    __klogger_index_update(header);
+}
+
+static int __klogger_index_create(const char* file_name)
+{
+    char index_name[sizeof(KLOGGER_INDEX_SUFFIX) + 256] = {0};
+    snprintf(&index_name[0], sizeof(index_name), "%s%s", file_name, KLOGGER_INDEX_SUFFIX);
+
+    klogger_priv_data.index_fd = open(&index_name[0], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (klogger_priv_data.index_fd == -1)
+    {
+        perror("Klogger: open index error");
+        return 1;
+    }
+
+    const KLogger_index_header index_header = {.magic = KLOGGER_INDEX_MAGIC,
+                                               .version = KLOGGER_INDEX_VERSION,
+                                               .entry_size = sizeof(KLogger_index_entry),
+                                               .block_size = KLOGGER_INDEX_BLOCK_SIZE
+                                              };
+    if (write(klogger_priv_data.index_fd, &index_header, sizeof(index_header)) != (ssize_t)sizeof(index_header))
+    {
+        perror("Klogger: write index error");
+        close(klogger_priv_data.index_fd);
+        klogger_priv_data.index_fd = -1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void __klogger_index_update(const KLogger_record_header* header)
+{
+    if (klogger_priv_data.index_fd == -1)
+        return;
+
+    KLogger_index_entry* const block = &klogger_priv_data.block;
+
+    /* First record in block, last_ts is kept from previous block to be monotonic */
+    if (block->size == 0)
+    {
+        block->offset = klogger_priv_data.file_offset;
+        block->first_ts = header->timestamp;
+        block->levels = 0;
+    }
+
+    if (header->timestamp < block->first_ts)
+        block->first_ts = header->timestamp;
+
+    if (header->timestamp > block->last_ts)
+        block->last_ts = header->timestamp;
+
+    block->levels |= 1u << header->level;
+    block->size += header->size;
+    klogger_priv_data.file_offset += header->size;
+
+    if (block->size >= KLOGGER_INDEX_BLOCK_SIZE)
+        __klogger_index_flush();
+}
+
+static void __klogger_index_flush(void)
+{
+    if (klogger_priv_data.index_fd == -1 || klogger_priv_data.block.size == 0)
+        return;
+
+    if (write(klogger_priv_data.index_fd, &klogger_priv_data.block, sizeof(klogger_priv_data.block)) != (ssize_t)sizeof(klogger_priv_data.block))
+        perror("Klogger: write index error");
+
+    klogger_priv_data.block.size = 0;
+}
+
+static void __klogger_index_close(void)
+{
+    if (klogger_priv_data.index_fd == -1)
+        return;
+
+    /* last block is not full, but it has to be in index too */
+    __klogger_index_flush();
+    close(klogger_priv_data.index_fd);
+    klogger_priv_data.index_fd = -1;
+}
+
+static int __klogger_trace_create(const char* file_name)
+{
+    char trace_name[sizeof(".trace.json") + 256] = {0};
+    snprintf(&trace_name[0], sizeof(trace_name), "%s.trace.json", file_name);
+
+    klogger_priv_data.trace_fd = open(&trace_name[0], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (klogger_priv_data.trace_fd == -1)
+    {
+        perror("Klogger: open trace error");
+        return 1;
+    }
+
+    /* Every event ends with comma, __klogger_trace_finish closes the array */
+    if (write(klogger_priv_data.trace_fd, "[\n", 2) != 2)
+    {
+        perror("Klogger: write trace error");
+        close(klogger_priv_data.trace_fd);
+        klogger_priv_data.trace_fd = -1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void __klogger_trace_finish(void)
+{
+    /* Instant event as a last one, because JSON does not allow comma before ] */
+    char buffer[256];
+    const int64_t ns_now = __klogger_monotonic_ns();
+    const int len = snprintf(&buffer[0],
+                             sizeof(buffer),
+                             "{\"name\":\"klogger_deinit\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%ld}\n]\n",
+                             (double)ns_now / 1000.0,
+                             (long)getpid(),
+                             (long)syscall(__NR_gettid));
+
+    if (write(klogger_priv_data.trace_fd, &buffer[0], (size_t)len) != len)
+        perror("Klogger: write trace error");
+}
+
+static size_t __klogger_write_json_string(char *buffer, size_t buffer_size, const char* str)
+{
+    size_t bytes_written = 0;
+
+    /* Leave space for escaped char + '"' + '\0' */
+    if (buffer_size < 4)
+        return 0;
+
+    buffer[bytes_written++] = '"';
+    for (; *str != '\0' && bytes_written < buffer_size - 3; ++str)
+    {
+        /* Control chars are useless in names, skip them */
+        if ((unsigned char)*str < 0x20)
+            continue;
+
+        if (*str == '"' || *str == '\\')
+            buffer[bytes_written++] = '\\';
+
+        buffer[bytes_written++] = *str;
+    }
+    buffer[bytes_written++] = '"';
+    buffer[bytes_written] = '\0';
+
+    return bytes_written;
+}
+
+static int64_t __klogger_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void __klogger_ctx_render(KLogger_ctx* ctx)
+{
+    ctx->prefix_size = 0;
+    ctx->json_size = 0;
+
+    if (ctx->entries == 0)
+        return;
+
+    ctx->prefix[ctx->prefix_size++] = '[';
+    for (size_t i = 0; i < ctx->entries; ++i)
+    {
+        const char* key = &ctx->pool[ctx->entry_offset[i]];
+        const char* value = key + strlen(key) + 1;
+
+        if (i > 0)
+            ctx->prefix[ctx->prefix_size++] = ' ';
+        ctx->prefix_size += __klogger_write_ctx_string(&ctx->prefix[ctx->prefix_size], sizeof(ctx->prefix) - ctx->prefix_size, key);
+        ctx->prefix[ctx->prefix_size++] = '=';
+        ctx->prefix_size += __klogger_write_ctx_string(&ctx->prefix[ctx->prefix_size], sizeof(ctx->prefix) - ctx->prefix_size, value);
+
+        ctx->json[ctx->json_size++] = ',';
+        ctx->json_size += __klogger_write_json_string(&ctx->json[ctx->json_size], sizeof(ctx->json) - ctx->json_size, key);
+        ctx->json[ctx->json_size++] = ':';
+        ctx->json_size += __klogger_write_json_string(&ctx->json[ctx->json_size], sizeof(ctx->json) - ctx->json_size, value);
+    }
+    ctx->prefix_size += (size_t)snprintf(&ctx->prefix[ctx->prefix_size], sizeof(ctx->prefix) - ctx->prefix_size, "] ");
+}
+
+static size_t __klogger_write_ctx_string(char *buffer, size_t buffer_size, const char* str)
+{
+    size_t bytes_written = 0;
+
+    /* Control chars (i.e new line) would split record, skip them like in JSON */
+    for (; *str != '\0' && bytes_written < buffer_size - 1; ++str)
+        if ((unsigned char)*str >= 0x20)
+            buffer[bytes_written++] = *str;
+
+    buffer[bytes_written] = '\0';
+
+    return bytes_written;
+}
+
+static void __klogger_atfork_prepare(void)
+{
+    /* Nobody can be in the middle of __klogger_print during fork, so buffers are consistent */
+    if (klogger_priv_data.is_init)
+        mtx_lock(&klogger_priv_data.mutex);
+}
+
+static void __klogger_atfork_parent(void)
+{
+    if (!klogger_priv_data.is_init)
+        return;
+
+    /*
+        Without collector child writes into the same file, so offsets, time and levels of its records are unknown here.
+        Index ends with the last block before fork, readers scan the rest of file as not indexed tail.
+    */
+    if (!klogger_priv_data.options.multiprocess)
+        __klogger_index_close();
+
+    mtx_unlock(&klogger_priv_data.mutex);
+}
+
+static void __klogger_atfork_child(void)
+{
+    if (!klogger_priv_data.is_init)
+        return;
+
+    /* Index is written only by the owner of file (collector or parent), drop inherited descriptor and block */
+    if (klogger_priv_data.index_fd != -1)
+    {
+        close(klogger_priv_data.index_fd);
+        klogger_priv_data.index_fd = -1;
+        klogger_priv_data.block.size = 0;
+    }
+
+    /* Child has only one thread, mutex could be locked by thread which does not exist here */
+    if (mtx_init(&klogger_priv_data.mutex, mtx_plain) != thrd_success)
+        klogger_priv_data.is_init = false;
+}
+
+static void __klogger_atexit(void)
+{
+    /* Collector exits without klogger_deinit, records from workers still in ring would be lost */
+    if (klogger_priv_data.is_init && klogger_priv_data.ring != NULL && klogger_priv_data.collector_pid == getpid())
+        klogger_deinit();
+}
+
+static KLogger_shm_ring* __klogger_shm_ring_create(void)
+{
+    KLogger_shm_ring* ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        perror("Klogger: mmap error");
+        return NULL;
+    }
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+    const int mutex_ret = pthread_mutex_init(&ring->mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+
+    if (mutex_ret != 0)
+    {
+        fprintf(stderr, "Klogger: Cannot init shared memory ring\n");
+        munmap(ring, sizeof(*ring));
+        return NULL;
+    }
+
+    /* MAP_ANONYMOUS memory is zeroed, so futex words, head, tail, used and stop are ready */
+    return ring;
+}
+
+static void __klogger_shm_ring_destroy(KLogger_shm_ring* ring)
+{
+    pthread_mutex_destroy(&ring->mutex);
+    munmap(ring, sizeof(*ring));
+}
+
+static void __klogger_shm_ring_lock(KLogger_shm_ring* ring)
+{
+    /* Previous owner died with this lock, it has not published its record, so ring is still consistent */
+    if (pthread_mutex_lock(&ring->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&ring->mutex);
+}
+
+static void __klogger_shm_ring_wait(KLogger_shm_ring* ring, uint32_t* word, uint32_t* waiters)
+{
+    /* Word is changed only under mutex, so change between unlock and FUTEX_WAIT is not lost (kernel compares it) */
+    const uint32_t value = *word;
+    ++*waiters;
+    pthread_mutex_unlock(&ring->mutex);
+
+    syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+
+    __klogger_shm_ring_lock(ring);
+    --*waiters;
+}
+
+static void __klogger_shm_ring_wake(uint32_t* word, int waiters)
+{
+    /* Caller has changed word under mutex, so every waiter which has not slept yet will not sleep */
+    syscall(SYS_futex, word, FUTEX_WAKE, waiters, NULL, NULL, 0);
+}
+
+static size_t __klogger_shm_ring_copy_in(KLogger_shm_ring* ring, size_t pos, const void* src, size_t size)
+{
+    /* Data can wrap around the end of ring, so copy it in 2 parts */
+    const size_t first_part = size < sizeof(ring->data) - pos ? size : sizeof(ring->data) - pos;
+    memcpy(&ring->data[pos], src, first_part);
+    memcpy(&ring->data[0], (const char*)src + first_part, size - first_part);
+
+    return (pos + size) % sizeof(ring->data);
+}
+
+static size_t __klogger_shm_ring_copy_out(KLogger_shm_ring* ring, size_t pos, void* dst, size_t size, size_t dst_size)
+{
+    /* Bytes which do not fit into dst are skipped */
+    const size_t to_copy = size < dst_size ? size : dst_size;
+    const size_t first_part = to_copy < sizeof(ring->data) - pos ? to_copy : sizeof(ring->data) - pos;
+    memcpy(dst, &ring->data[pos], first_part);
+    memcpy((char*)dst + first_part, &ring->data[0], to_copy - first_part);
+
+    return (pos + size) % sizeof(ring->data);
+}
+
+static void __klogger_shm_ring_push(KLogger_shm_ring* ring, const char* record, const KLogger_record_header* header, bool wait_written)
+{
+    /* Record has to fit into the ring with its header */
+    KLogger_record_header ring_header = *header;
+    if (ring_header.size > sizeof(ring->data) - sizeof(ring_header))
+        ring_header.size = sizeof(ring->data) - sizeof(ring_header);
+
+    const size_t total_size = sizeof(ring_header) + ring_header.size;
+
+    __klogger_shm_ring_lock(ring);
+
+    while (!ring->stop && sizeof(ring->data) - ring->used < total_size)
+        __klogger_shm_ring_wait(ring, &ring->popped, &ring->popped_waiters);
+
+    /* Collector is not going to read anything more */
+    if (ring->stop)
+    {
+        pthread_mutex_unlock(&ring->mutex);
+        return;
+    }
+
+    /* Copy whole record first, then publish it, so record is in ring entirely or not at all */
+    size_t head = __klogger_shm_ring_copy_in(ring, ring->head, &ring_header, sizeof(ring_header));
+    head = __klogger_shm_ring_copy_in(ring, head, record, ring_header.size);
+
+    ring->head = head;
+    ring->used += total_size;
+    ++ring->pushed;
+    const uint32_t record_number = ++ring->records;
+
+    if (ring->pushed_waiters > 0)
+        __klogger_shm_ring_wake(&ring->pushed, 1);
+
+    /* Record is on descriptors when this function returns (collector finishes all records even after stop) */
+    if (wait_written)
+        while ((int32_t)(ring->written - record_number) < 0)
+            __klogger_shm_ring_wait(ring, &ring->written, &ring->written_waiters);
+
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+static bool __klogger_shm_ring_pop(KLogger_shm_ring* ring, char* record, size_t record_size_max, KLogger_record_header* header, uint32_t written)
+{
+    __klogger_shm_ring_lock(ring);
+
+    /* Previous records are on descriptors, publish it before waiting for new ones */
+    if (ring->written != written)
+    {
+        ring->written = written;
+        if (ring->written_waiters > 0)
+            __klogger_shm_ring_wake(&ring->written, INT_MAX);
+    }
+
+    while (!ring->stop && ring->used == 0)
+        __klogger_shm_ring_wait(ring, &ring->pushed, &ring->pushed_waiters);
+
+    /* stop + empty ring, collector can finish */
+    if (ring->used == 0)
+    {
+        pthread_mutex_unlock(&ring->mutex);
+        return false;
+    }
+
+    size_t tail = __klogger_shm_ring_copy_out(ring, ring->tail, header, sizeof(*header), sizeof(*header));
+    tail = __klogger_shm_ring_copy_out(ring, tail, record, header->size, record_size_max);
+
+    ring->tail = tail;
+    ring->used -= sizeof(*header) + header->size;
+    ++ring->popped;
+    const bool wake = ring->popped_waiters > 0;
+
+    pthread_mutex_unlock(&ring->mutex);
+
+    if (wake)
+        __klogger_shm_ring_wake(&ring->popped, INT_MAX);
+
+    if (header->size > record_size_max)
+        header->size = (uint32_t)record_size_max;
+
+    return true;
+}
+
+static int __klogger_shm_collector(void* arg)
+{
+    KLogger_shm_ring* ring = arg;
+
+    /* Only this thread uses this buffer, record cannot be bigger than print buffer */
+    static char buffer[1 << 20];
+
+    KLogger_record_header header;
+    uint32_t written = 0;
+    while (__klogger_shm_ring_pop(ring, &buffer[0], sizeof(buffer), &header, written))
+    {
+        __klogger_write_record(&buffer[0], &header);
+        ++written;
+    }
+
+    return 0;
+}
 
 int klogger_init(int fd, klogger_level_t lvl, klogger_option_t options)
 {
@@ -136,12 +737,40 @@ int klogger_init(int fd, klogger_level_t lvl, klogger_option_t options)
         return 1;
     }
 
+    /* Fork handlers cannot be unregistered, so register them only once */
+    static bool atfork_registered = false;
+    if (!atfork_registered)
+    {
+        if (pthread_atfork(__klogger_atfork_prepare, __klogger_atfork_parent, __klogger_atfork_child) != 0)
+        {
+            perror("Klogger: pthread_atfork error");
+            return 1;
+        }
+        atfork_registered = true;
+    }
+
+    /* The same for exit handler */
+    static bool atexit_registered = false;
+    if (!atexit_registered)
+    {
+        if (atexit(__klogger_atexit) != 0)
+        {
+            perror("Klogger: atexit error");
+            return 1;
+        }
+        atexit_registered = true;
+    }
+
     /* INIT logger as a customized logger for user */
     klogger_priv_data.options = __klogger_parse_useroptions(fd, lvl, options);
 
     /* By default, incorrect fd is have -1 value */
     memset(&klogger_priv_data.fd[0], -1, sizeof(klogger_priv_data.fd));
     klogger_priv_data.file_fd = -1;
+    klogger_priv_data.index_fd = -1;
+    klogger_priv_data.trace_fd = -1;
+    klogger_priv_data.file_offset = 0;
+    klogger_priv_data.block = (KLogger_index_entry){0};
 
     /* Write down all correct descriptors */
     size_t fd_idx = 0;
@@ -226,16 +855,90 @@ int klogger_init(int fd, klogger_level_t lvl, klogger_option_t options)
             }
 
             klogger_priv_data.fd[fd_idx++] = klogger_priv_data.file_fd;
+
+            /* Sidecar index: log_name.log.idx */
+            if (klogger_priv_data.options.file_index)
+                if (__klogger_index_create(&file_name[0]) != 0)
+                    return 1;
+
+            /* Trace events: log_name.log.trace.json */
+            if (klogger_priv_data.options.file_trace)
+                if (__klogger_trace_create(&file_name[0]) != 0)
+                    return 1;
         } while (max_tries < 10);
     }
 
+    /* Workers forked after init log into ring, this process writes all of them */
+    klogger_priv_data.ring = NULL;
+    if (klogger_priv_data.options.multiprocess)
+    {
+        klogger_priv_data.ring = __klogger_shm_ring_create();
+        if (klogger_priv_data.ring == NULL)
+            return 1;
+
+        klogger_priv_data.collector_pid = getpid();
+        if (thrd_create(&klogger_priv_data.collector, __klogger_shm_collector, klogger_priv_data.ring) != thrd_success)
+        {
+            perror("Klogger: thrd_create error");
+            __klogger_shm_ring_destroy(klogger_priv_data.ring);
+            klogger_priv_data.ring = NULL;
+            return 1;
+        }
+    }
+
+    /* Reference point for spans, ticks per ns is computed on every span end */
+    klogger_priv_data.init_pid = getpid();
+    klogger_priv_data.ticks_ref = __klogger_ticks();
+    klogger_priv_data.ns_ref = __klogger_monotonic_ns();
+
     klogger_priv_data.is_init = true;
+    __klogger_level = (int)klogger_priv_data.options.level;
 
     return 0;
 }
 
 void klogger_deinit(void)
 {
+    __klogger_level = -1;
+
+    if (klogger_priv_data.ring != NULL)
+    {
+        if (klogger_priv_data.collector_pid == getpid())
+        {
+            /* Collector flushes all records and then finishes */
+            __klogger_shm_ring_lock(klogger_priv_data.ring);
+            klogger_priv_data.ring->stop = true;
+            ++klogger_priv_data.ring->pushed;
+            ++klogger_priv_data.ring->popped;
+            pthread_mutex_unlock(&klogger_priv_data.ring->mutex);
+
+            __klogger_shm_ring_wake(&klogger_priv_data.ring->pushed, INT_MAX);
+            __klogger_shm_ring_wake(&klogger_priv_data.ring->popped, INT_MAX);
+
+            thrd_join(klogger_priv_data.collector, NULL);
+            __klogger_shm_ring_destroy(klogger_priv_data.ring);
+        }
+        else /* Worker only detaches, ring is still used by others */
+        {
+            munmap(klogger_priv_data.ring, sizeof(*klogger_priv_data.ring));
+        }
+
+        klogger_priv_data.ring = NULL;
+    }
+
+    /* close index */
+    __klogger_index_close();
+
+    /* close trace, only owner closes JSON array, workers share the same file */
+    if (klogger_priv_data.trace_fd != -1)
+    {
+        if (klogger_priv_data.init_pid == getpid())
+            __klogger_trace_finish();
+
+        close(klogger_priv_data.trace_fd);
+        klogger_priv_data.trace_fd = -1;
+    }
+
     /* close file */
     if (klogger_priv_data.file_fd != -1)
         close(klogger_priv_data.file_fd);
@@ -247,12 +950,7 @@ void klogger_deinit(void)
 }
 
 
-void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
-                                                             const char* func,
-                                                             int line,
-                                                             klogger_level_t level,
-                                                             const char* fmt,
-                                                             ...)
+static bool __klogger_record_lock(klogger_level_t level)
 {
     if (!klogger_priv_data.is_init)
     {
@@ -262,46 +960,76 @@ void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
             fprintf(stderr, "Klogger: Please init klogger before use\n");
         printed = true;
 
-        return;
+        return false;
     }
 
     /* Cannot change lvl during work, so reading by a few threads is ok! */
     if (klogger_priv_data.options.level < level)
-        return;
+        return false;
 
     if (mtx_lock(&klogger_priv_data.mutex) != thrd_success)
     {
         perror("Klogger: mtx_lock error");
-        return;
+        return false;
     }
 
-    /* klogger is thread safe, so we can use static buffer here */
-    static char buffer[1 << 20] = {0};
+    return true;
+}
+
+static size_t __klogger_record_begin(char* buffer,
+                                     size_t buffer_size,
+                                     const char* file,
+                                     const char* func,
+                                     int line,
+                                     klogger_level_t level,
+                                     struct timeval* timeval_now)
+{
     size_t buffer_index = 0;
 
-    buffer_index = (size_t)snprintf(&buffer[0], sizeof(buffer) - buffer_index, "[%s] ", klogger_priv_level_string[level]);
+    buffer_index = (size_t)snprintf(&buffer[0], buffer_size - buffer_index, "[%s] ", klogger_priv_level_string[level]);
+
+    /* h:min:sec can be obtanined from localtime, but we need a usec too, use gettimeofday */
+    *timeval_now = (struct timeval){0};
+    if (klogger_priv_data.options.timestamp || klogger_priv_data.options.file_index)
+        gettimeofday(timeval_now, NULL);
 
     /* Add timestamp if needed. Format: h:min:sec.usec */
     if (klogger_priv_data.options.timestamp)
-        buffer_index += __klogger_write_timestamp(&buffer[buffer_index], sizeof(buffer) - buffer_index);
+        buffer_index += __klogger_write_timestamp(&buffer[buffer_index], buffer_size - buffer_index, timeval_now);
+
+    /* Add PID if needed, records from all workers are merged into one log */
+    if (klogger_priv_data.options.multiprocess)
+        buffer_index += __klogger_write_pid(&buffer[buffer_index], buffer_size - buffer_index);
 
     /* Add threadID if needed. */
     if (klogger_priv_data.options.multithreading)
-        buffer_index += __klogger_write_tid(&buffer[buffer_index], sizeof(buffer) - buffer_index);
+        buffer_index += __klogger_write_tid(&buffer[buffer_index], buffer_size - buffer_index);
 
-    /* Add file line and func */
-    buffer_index += (size_t)snprintf(&buffer[buffer_index], sizeof(buffer) - buffer_index, "%s:%d %s: ", file, line, func);
+    /* Add context of this thread, it is already rendered */
+    if (klogger_priv_ctx.prefix_size > 0 && klogger_priv_ctx.prefix_size < buffer_size - buffer_index)
+    {
+        memcpy(&buffer[buffer_index], &klogger_priv_ctx.prefix[0], klogger_priv_ctx.prefix_size);
+        buffer_index += klogger_priv_ctx.prefix_size;
+    }
 
-    /* Add user message */
-    va_list args;
-    va_start(args, fmt);
+    /* Add file line and func */
+    buffer_index += (size_t)snprintf(&buffer[buffer_index], buffer_size - buffer_index, "%s:%d %s: ", file, line, func);
 
-    buffer_index += (size_t)vsnprintf(&buffer[buffer_index], sizeof(buffer) - buffer_index, fmt, args);
+    return buffer_index;
+}
 
-    va_end(args);
+static void __klogger_record_end(char* buffer,
+                                 size_t buffer_size,
+                                 size_t buffer_index,
+                                 klogger_level_t level,
+                                 const struct timeval* timeval_now)
+{
+    /* snprintf returns bytes which would be written, so buffer could be truncated */
+    if (buffer_index > buffer_size - 1)
+        buffer_index = buffer_size - 1;
 
     /* User has forgotten new line add for him */
-    if (buffer[buffer_index - 1] != '\n' && buffer_index < sizeof(buffer) - 1)
+    if (buffer[buffer_index - 1] != '\n' && buffer_index < buffer_size - 1)
     {
         buffer[buffer_index++] = '\n';
         buffer[buffer_index] = '\0';
@@ -309,12 +1037,155 @@ void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
 
     /* FATAL, user should close app, log stacktrace */
     if (level == KLOGGER_LEVEL_FATAL)
-        buffer_index += __klogger_write_stacktrace(&buffer[buffer_index], sizeof(buffer) - buffer_index);
+        buffer_index += __klogger_write_stacktrace(&buffer[buffer_index], buffer_size - buffer_index);
 
-    /* buffer created, write into all valid descriptors */
-    for (size_t i = 0; i < KLOGGER_DATA_MAX_FD; ++i)
-        if (klogger_priv_data.fd[i] > 0)
-            dprintf(klogger_priv_data.fd[i], "%s", &buffer[0]);
+    if (buffer_index > buffer_size - 1)
+        buffer_index = buffer_size - 1;
+
+    const KLogger_record_header header = {.size = (uint32_t)buffer_index,
+                                          .level = (uint32_t)level,
+                                          .timestamp = (int64_t)timeval_now->tv_sec * 1000000 + timeval_now->tv_usec
+                                         };
+
+    /* buffer created, pass it to collector or write into all valid descriptors */
+    if (klogger_priv_data.ring != NULL)
+        __klogger_shm_ring_push(klogger_priv_data.ring, &buffer[0], &header, level == KLOGGER_LEVEL_FATAL);
+    else
+        __klogger_write_record(&buffer[0], &header);
 
     mtx_unlock(&klogger_priv_data.mutex);
 }
+
+void __attribute__(( format(printf, 5, 6) )) __klogger_print(const char* file,
+                                                             const char* func,
+                                                             int line,
+                                                             klogger_level_t level,
+                                                             const char* fmt,
+                                                             ...)
+{
+    if (!__klogger_record_lock(level))
+        return;
+
+    struct timeval timeval_now;
+    size_t buffer_index = __klogger_record_begin(&klogger_priv_buffer[0], sizeof(klogger_priv_buffer), file, func, line, level, &timeval_now);
+
+    /* Add user message */
+    va_list args;
+    va_start(args, fmt);
+
+    if (buffer_index < sizeof(klogger_priv_buffer))
+        buffer_index += (size_t)vsnprintf(&klogger_priv_buffer[buffer_index], sizeof(klogger_priv_buffer) - buffer_index, fmt, args);
+
+    va_end(args);
+
+    __klogger_record_end(&klogger_priv_buffer[0], sizeof(klogger_priv_buffer), buffer_index, level, &timeval_now);
+}
+
+void __klogger_print_raw(const char* file,
+                         const char* func,
+                         int line,
+                         klogger_level_t level,
+                         const char* msg,
+                         size_t msg_size)
+{
+    if (!__klogger_record_lock(level))
+        return;
+
+    struct timeval timeval_now;
+    size_t buffer_index = __klogger_record_begin(&klogger_priv_buffer[0], sizeof(klogger_priv_buffer), file, func, line, level, &timeval_now);
+
+    /* Message is already formatted by front end, just copy it */
+    if (buffer_index < sizeof(klogger_priv_buffer) - 1)
+    {
+        const size_t to_copy = msg_size < sizeof(klogger_priv_buffer) - 1 - buffer_index ? msg_size : sizeof(klogger_priv_buffer) - 1 - buffer_index;
+        memcpy(&klogger_priv_buffer[buffer_index], msg, to_copy);
+        buffer_index += to_copy;
+        klogger_priv_buffer[buffer_index] = '\0';
+    }
+
+    __klogger_record_end(&klogger_priv_buffer[0], sizeof(klogger_priv_buffer), buffer_index, level, &timeval_now);
+}
+
+void __klogger_span_emit(const klogger_span_t* span, uint64_t end)
+{
+    if (!klogger_priv_data.is_init)
+        return;
+
+    /* Ticks are TSC on x86, convert them using ticks and ns elapsed since init */
+    const int64_t ns_now = __klogger_monotonic_ns();
+    const uint64_t ticks_now = __klogger_ticks();
+    const double ns_per_tick = ticks_now > klogger_priv_data.ticks_ref ?
+                               (double)(ns_now - klogger_priv_data.ns_ref) / (double)(ticks_now - klogger_priv_data.ticks_ref) :
+                               1.0;
+
+    const double duration_ns = (double)(end - span->start) * ns_per_tick;
+
+    __klogger_print(span->file, span->func, span->line, span->level, "%s took %.3f us", span->name, duration_ns / 1000.0);
+
+    if (klogger_priv_data.trace_fd == -1)
+        return;
+
+    /* Complete event (ph X), ts and dur in usec, start is computed back from now */
+    char buffer[4096 + sizeof(klogger_priv_ctx.json)];
+    size_t buffer_index = 0;
+    const double start_us = ((double)ns_now - (double)(ticks_now - span->start) * ns_per_tick) / 1000.0;
+
+    buffer_index += (size_t)snprintf(&buffer[buffer_index], sizeof(buffer) - buffer_index, "{\"name\":");
+    buffer_index += __klogger_write_json_string(&buffer[buffer_index], KLOGGER_TRACE_STRING_MAX, span->name);
+    buffer_index += (size_t)snprintf(&buffer[buffer_index],
+                                     sizeof(buffer) - buffer_index,
+                                     ",\"cat\":\"%.*s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,\"args\":{\"file\":",
+                                     (int)strcspn(klogger_priv_level_string[span->level], " "),
+                                     klogger_priv_level_string[span->level],
+                                     start_us,
+                                     duration_ns / 1000.0,
+                                     (long)getpid(),
+                                     (long)syscall(__NR_gettid));
+    buffer_index += __klogger_write_json_string(&buffer[buffer_index], KLOGGER_TRACE_STRING_MAX, span->file);
+    buffer_index += (size_t)snprintf(&buffer[buffer_index], sizeof(buffer) - buffer_index, ",\"line\":%d,\"func\":", span->line);
+    buffer_index += __klogger_write_json_string(&buffer[buffer_index], KLOGGER_TRACE_STRING_MAX, span->func);
+
+    /* Context fields are native args of event */
+    memcpy(&buffer[buffer_index], &klogger_priv_ctx.json[0], klogger_priv_ctx.json_size);
+    buffer_index += klogger_priv_ctx.json_size;
+
+    buffer_index += (size_t)snprintf(&buffer[buffer_index], sizeof(buffer) - buffer_index, "}},\n");
+
+    /* One write per event, so events from threads and workers are not mixed */
+    if (write(klogger_priv_data.trace_fd, &buffer[0], buffer_index) != (ssize_t)buffer_index)
+        perror("Klogger: write trace error");
+}
+
+int klogger_ctx_push(const char* key, const char* value)
+{
+    KLogger_ctx* const ctx = &klogger_priv_ctx;
+    const size_t key_size = strlen(key) + 1;
+    const size_t value_size = strlen(value) + 1;
+
+    if (ctx->entries == KLOGGER_CTX_MAX || key_size + value_size > sizeof(ctx->pool) - ctx->pool_used)
+    {
+        fprintf(stderr, "Klogger: No space for context %s=%s\n", key, value);
+        return 1;
+    }
+
+    ctx->entry_offset[ctx->entries++] = ctx->pool_used;
+    memcpy(&ctx->pool[ctx->pool_used], key, key_size);
+    ctx->pool_used += key_size;
+    memcpy(&ctx->pool[ctx->pool_used], value, value_size);
+    ctx->pool_used += value_size;
+
+    __klogger_ctx_render(ctx);
+
+    return 0;
+}
+
+void klogger_ctx_pop(void)
+{
+    KLogger_ctx* const ctx = &klogger_priv_ctx;
+    if (ctx->entries == 0)
+        return;
+
+    ctx->pool_used = ctx->entry_offset[--ctx->entries];
+
+    __klogger_ctx_render(ctx);
+}
@@ -0,0 +1,595 @@
+/* memmem, memrchr */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <klogger/klogger.h>
+#include <klogger/klogger-index.h>
+
+/*
+    klogger-query - search KLogger log file using sidecar index
+
+    Author: Michal Kukowski
+    email: michalkukowski10@gmail.com
+    LICENCE: GPL3
+
+    Tool reads index (log_file.idx), selects only blocks which can contain matching records
+    (time range + levels bitmap) and maps only those ranges of log file.
+    Without index whole file is scanned.
+*/
+
+#define KLOGGER_QUERY_LEVEL_STRING_LEN 8
+#define KLOGGER_QUERY_USEC_PER_DAY     (24LL * 3600 * 1000000)
+
+/* Keep it in proper order with alignment to biggest one (the same as in klogger.c) */
+static const char* klogger_query_level_string[] = {"FATAL   ",
+                                                   "CRITICAL",
+                                                   "ERROR   ",
+                                                   "WARNING ",
+                                                   "INFO    ",
+                                                   "DEBUG   ",
+                                                   "DEBUG2  ",
+                                                   "DEBUG3  ",
+                                                  };
+
+typedef struct KLogger_query
+{
+    bool use_time;          /* Filter by time range or not */
+    int64_t from;           /* usec since Epoch */
+    int64_t to;             /* usec since Epoch */
+    uint32_t levels;        /* bitmap of wanted levels (all bits set if not used) */
+    const char* source;     /* "file" or "file:line" or NULL */
+    size_t source_len;
+    bool source_line;       /* source has line, compare whole source field, not only path */
+    const char* message;    /* message substring or NULL */
+    size_t message_len;
+} KLogger_query;
+
+typedef struct KLogger_query_range
+{
+    uint64_t offset;
+    uint64_t size;
+} KLogger_query_range;
+
+static void __klogger_query_usage(const char* prog);
+
+/* SSE2 substring scan with memmem fallback, returns NULL if needle is not found */
+static const char* __klogger_query_find(const char* haystack, size_t haystack_size, const char* needle, size_t needle_size);
+
+/* Parse level name, returns -1 on error */
+static int __klogger_query_parse_level(const char* str);
+
+/* Parse @epoch_sec or HH:MM[:SS] (the day of first indexed record), returns 0 on success */
+static int __klogger_query_parse_time(const char* str, int64_t day_start, int64_t* usec);
+
+/* usec since Epoch of local midnight of this timestamp */
+static int64_t __klogger_query_day_start(int64_t usec);
+
+/* Read whole index, returns number of entries or -1 on error */
+static ssize_t __klogger_query_read_index(const char* log_name, KLogger_index_entry** entries);
+
+/* Select ranges of log file to scan, returns number of ranges */
+static size_t __klogger_query_select(const KLogger_query* query,
+                                     const KLogger_index_entry* entries,
+                                     size_t entries_num,
+                                     uint64_t file_size,
+                                     KLogger_query_range* ranges);
+
+/* Find "file:line" field of record (after header and context), returns NULL if there is no such field */
+static const char* __klogger_query_source_field(const char* line, size_t line_size, size_t* field_size);
+
+/* Check if record matches query */
+static bool __klogger_query_match(const KLogger_query* query, const char* record, size_t record_size, int64_t day_start);
+
+/* Map range and print matching records, returns number of matched records */
+static size_t __klogger_query_scan(const KLogger_query* query, int fd, const KLogger_query_range* range, int64_t day_start);
+
+static void __klogger_query_usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] log_file\n"
+            "Options:\n"
+            "    -f, --from TIME            records not older than TIME\n"
+            "    -t, --to TIME              records not newer than TIME\n"
+            "    -l, --level LEVEL          records with LEVEL (FATAL, ..., DEBUG3), can be repeated\n"
+            "    -s, --source FILE[:LINE]   records logged from FILE (and LINE)\n"
+            "    -m, --message TEXT         records containing TEXT\n"
+            "    -h, --help                 this help\n"
+            "TIME is HH:MM[:SS] (day of the log) or @seconds since Epoch\n",
+            prog);
+}
+
+static const char* __klogger_query_find(const char* haystack, size_t haystack_size, const char* needle, size_t needle_size)
+{
+    if (needle_size == 0)
+        return haystack;
+
+    if (needle_size > haystack_size)
+        return NULL;
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /* Compare first and last char of needle on 16 positions at once, memcmp only candidates */
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+
+    for (; i + needle_size - 1 + sizeof(__m128i) <= haystack_size; i += sizeof(__m128i))
+    {
+        const __m128i block_first = _mm_loadu_si128((const __m128i*)(const void*)&haystack[i]);
+        const __m128i block_last = _mm_loadu_si128((const __m128i*)(const void*)&haystack[i + needle_size - 1]);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                                  _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            const unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(&haystack[i + bit + 1], &needle[1], needle_size - (needle_size > 1 ? 2 : 1)) == 0)
+                return &haystack[i + bit];
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return memmem(&haystack[i], haystack_size - i, needle, needle_size);
+}
+
+static int __klogger_query_parse_level(const char* str)
+{
+    const size_t len = strlen(str);
+    for (size_t i = 0; i < sizeof(klogger_query_level_string) / sizeof(klogger_query_level_string[0]); ++i)
+        if (len <= KLOGGER_QUERY_LEVEL_STRING_LEN &&
+            strncasecmp(klogger_query_level_string[i], str, len) == 0 &&
+            (len == KLOGGER_QUERY_LEVEL_STRING_LEN || klogger_query_level_string[i][len] == ' '))
+            return (int)i;
+
+    return -1;
+}
+
+static int64_t __klogger_query_day_start(int64_t usec)
+{
+    struct tm tm_time = *localtime(&(time_t){usec / 1000000});
+    tm_time.tm_hour = 0;
+    tm_time.tm_min = 0;
+    tm_time.tm_sec = 0;
+    tm_time.tm_isdst = -1;
+
+    return (int64_t)mktime(&tm_time) * 1000000;
+}
+
+static int __klogger_query_parse_time(const char* str, int64_t day_start, int64_t* usec)
+{
+    if (str[0] == '@')
+    {
+        char* end;
+        const long long sec = strtoll(&str[1], &end, 10);
+        if (*end != '\0')
+            return 1;
+
+        *usec = (int64_t)sec * 1000000;
+        return 0;
+    }
+
+    unsigned h = 0;
+    unsigned m = 0;
+    unsigned sec = 0;
+    const int fields = sscanf(str, "%u:%u:%u", &h, &m, &sec);
+    if (fields < 2 || h > 23 || m > 59 || sec > 60)
+        return 1;
+
+    *usec = day_start + ((int64_t)h * 3600 + m * 60 + sec) * 1000000;
+    return 0;
+}
+
+static ssize_t __klogger_query_read_index(const char* log_name, KLogger_index_entry** entries)
+{
+    char index_name[4096];
+    snprintf(&index_name[0], sizeof(index_name), "%s%s", log_name, KLOGGER_INDEX_SUFFIX);
+
+    const int fd = open(&index_name[0], O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    KLogger_index_header header;
+    if (fstat(fd, &st) == -1 ||
+        read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, KLOGGER_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != KLOGGER_INDEX_VERSION ||
+        header.entry_size != sizeof(KLogger_index_entry))
+    {
+        fprintf(stderr, "klogger-query: %s is not a valid index\n", &index_name[0]);
+        close(fd);
+        return -1;
+    }
+
+    const size_t entries_num = ((size_t)st.st_size - sizeof(header)) / sizeof(KLogger_index_entry);
+    /* +1, index without entries is valid but malloc(0) can return NULL */
+    *entries = malloc((entries_num + 1) * sizeof(KLogger_index_entry));
+    if (*entries == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    const ssize_t bytes = read(fd, *entries, entries_num * sizeof(KLogger_index_entry));
+    close(fd);
+
+    if (bytes < 0)
+    {
+        free(*entries);
+        *entries = NULL;
+        return -1;
+    }
+
+    return bytes / (ssize_t)sizeof(KLogger_index_entry);
+}
+
+static size_t __klogger_query_select(const KLogger_query* query,
+                                     const KLogger_index_entry* entries,
+                                     size_t entries_num,
+                                     uint64_t file_size,
+                                     KLogger_query_range* ranges)
+{
+    size_t ranges_num = 0;
+
+    /* last_ts is monotonic, binary search first block which can have records newer than from */
+    size_t low = 0;
+    size_t high = entries_num;
+    while (query->use_time && low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        if (entries[mid].last_ts < query->from)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    for (size_t i = low; i < entries_num; ++i)
+    {
+        /*
+            Only last_ts is monotonic. first_ts is not, record of delayed worker (multiprocess mode)
+            can land in later block, so skip this block but check the next ones.
+        */
+        if (query->use_time && entries[i].first_ts > query->to)
+            continue;
+
+        if ((entries[i].levels & query->levels) == 0)
+            continue;
+
+        /* Merge neighbours to map them at once */
+        if (ranges_num > 0 && ranges[ranges_num - 1].offset + ranges[ranges_num - 1].size == entries[i].offset)
+            ranges[ranges_num - 1].size += entries[i].size;
+        else
+            ranges[ranges_num++] = (KLogger_query_range){.offset = entries[i].offset, .size = entries[i].size};
+    }
+
+    /* Bytes after last indexed block has not been indexed yet, scan them always */
+    const uint64_t indexed_end = entries_num > 0 ? entries[entries_num - 1].offset + entries[entries_num - 1].size : 0;
+    if (indexed_end < file_size)
+    {
+        if (ranges_num > 0 && ranges[ranges_num - 1].offset + ranges[ranges_num - 1].size == indexed_end)
+            ranges[ranges_num - 1].size += file_size - indexed_end;
+        else
+            ranges[ranges_num++] = (KLogger_query_range){.offset = indexed_end, .size = file_size - indexed_end};
+    }
+
+    return ranges_num;
+}
+
+static const char* __klogger_query_source_field(const char* line, size_t line_size, size_t* field_size)
+{
+    size_t pos = KLOGGER_QUERY_LEVEL_STRING_LEN + 3;
+
+    /* Skip optional [h:min:sec.usec] [PID: x] [TID: y] */
+    if (line_size > pos + 18 && line[pos] == '[' && line[pos + 3] == ':' && line[pos + 16] == ']')
+        pos += 18;
+
+    for (size_t i = 0; i < 2; ++i)
+        if (line_size > pos + 6 && (memcmp(&line[pos], "[PID: ", 6) == 0 || memcmp(&line[pos], "[TID: ", 6) == 0))
+        {
+            const char* const id_end = memchr(&line[pos], ']', line_size - pos);
+            if (id_end == NULL)
+                return NULL;
+
+            pos = (size_t)(id_end - line) + 2;
+        }
+
+    /* Context "[k=v ...] " can contain anything, so try every position after "] " until field looks like "file:line func: " */
+    const bool has_context = pos < line_size && line[pos] == '[';
+    while (pos < line_size)
+    {
+        const char* const field = &line[pos];
+        const char* const field_end = memchr(field, ' ', line_size - pos);
+        const char* const colon = field_end != NULL ? memrchr(field, ':', (size_t)(field_end - field)) : NULL;
+        const char* const func_end = field_end != NULL ? memchr(field_end + 1, ' ', line_size - (size_t)(field_end + 1 - line)) : NULL;
+
+        bool is_source = colon != NULL && colon + 1 < field_end && func_end != NULL && func_end > field_end + 1 && func_end[-1] == ':';
+        for (const char* c = colon + 1; is_source && c < field_end; ++c)
+            is_source = *c >= '0' && *c <= '9';
+
+        if (is_source)
+        {
+            *field_size = (size_t)(field_end - field);
+            return field;
+        }
+
+        if (!has_context)
+            return NULL;
+
+        const char* const context_end = memmem(field, line_size - pos, "] ", 2);
+        if (context_end == NULL)
+            return NULL;
+
+        pos = (size_t)(context_end - line) + 2;
+    }
+
+    return NULL;
+}
+
+static bool __klogger_query_match(const KLogger_query* query, const char* record, size_t record_size, int64_t day_start)
+{
+    /* Record: [LEVEL   ] [h:min:sec.usec] [PID: x] [TID: y] file:line func: msg */
+    int record_level = -1;
+    for (size_t i = 0; i < sizeof(klogger_query_level_string) / sizeof(klogger_query_level_string[0]); ++i)
+        if (memcmp(&record[1], klogger_query_level_string[i], KLOGGER_QUERY_LEVEL_STRING_LEN) == 0)
+            record_level = (int)i;
+
+    if (record_level == -1 || (query->levels & (1u << record_level)) == 0)
+        return false;
+
+    const size_t header_size = KLOGGER_QUERY_LEVEL_STRING_LEN + 3;
+    unsigned h;
+    unsigned m;
+    unsigned sec;
+    unsigned long usec;
+
+    /* Timestamp is optional, records without timestamp are filtered only by index */
+    if (query->use_time &&
+        record_size > header_size + 17 &&
+        sscanf(&record[header_size], "[%2u:%2u:%2u.%6lu]", &h, &m, &sec, &usec) == 4)
+    {
+        /*
+            Record has only time of the day, move it to the day nearest to the given range bound.
+            Not given bound is INT64_MIN / INT64_MAX, so it cannot be used (subtraction would overflow).
+        */
+        const int64_t day_usec = ((int64_t)h * 3600 + m * 60 + sec) * 1000000 + (int64_t)usec;
+        int64_t ts = day_start + day_usec;
+        if (query->from != INT64_MIN)
+        {
+            if (ts < query->from - KLOGGER_QUERY_USEC_PER_DAY / 2)
+                ts += (query->from - KLOGGER_QUERY_USEC_PER_DAY / 2 - ts + KLOGGER_QUERY_USEC_PER_DAY - 1) / KLOGGER_QUERY_USEC_PER_DAY * KLOGGER_QUERY_USEC_PER_DAY;
+        }
+        else if (query->to != INT64_MAX)
+        {
+            if (ts > query->to + KLOGGER_QUERY_USEC_PER_DAY / 2)
+                ts -= (ts - query->to - KLOGGER_QUERY_USEC_PER_DAY / 2 + KLOGGER_QUERY_USEC_PER_DAY - 1) / KLOGGER_QUERY_USEC_PER_DAY * KLOGGER_QUERY_USEC_PER_DAY;
+        }
+
+        if (ts < query->from || ts > query->to)
+            return false;
+    }
+
+    /* source and func are in the first line only */
+    const char* line_end = memchr(record, '\n', record_size);
+    const size_t line_size = line_end != NULL ? (size_t)(line_end - record) : record_size;
+
+    if (query->source != NULL)
+    {
+        size_t field_size;
+        const char* const field = __klogger_query_source_field(record, line_size, &field_size);
+        if (field == NULL)
+            return false;
+
+        /* Without line compare only path, so foo.c:1 does not match foo.c:12 and foo.c does not match foo.cpp */
+        if (!query->source_line)
+            field_size = (size_t)((const char*)memrchr(field, ':', field_size) - field);
+
+        /* Source has to be whole path or its suffix after '/', so main.c does not match domain.c */
+        if (field_size < query->source_len ||
+            memcmp(&field[field_size - query->source_len], query->source, query->source_len) != 0 ||
+            (field_size > query->source_len && field[field_size - query->source_len - 1] != '/'))
+            return false;
+    }
+
+    if (query->message != NULL && __klogger_query_find(record, record_size, query->message, query->message_len) == NULL)
+        return false;
+
+    return true;
+}
+
+static size_t __klogger_query_scan(const KLogger_query* query, int fd, const KLogger_query_range* range, int64_t day_start)
+{
+    if (range->size == 0)
+        return 0;
+
+    /* mmap offset has to be page aligned */
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t map_offset = range->offset & ~(page_size - 1);
+    const size_t map_size = (size_t)(range->size + range->offset - map_offset);
+
+    char* map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, (off_t)map_offset);
+    if (map == MAP_FAILED)
+    {
+        perror("klogger-query: mmap error");
+        return 0;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    const char* const data = &map[range->offset - map_offset];
+    const size_t data_size = (size_t)range->size;
+    size_t matched = 0;
+
+    /* Record starts with "[LEVEL   ] " at the beginning of line, stacktrace lines belong to previous record */
+    size_t record_start = 0;
+    while (record_start < data_size)
+    {
+        size_t record_end = record_start;
+        do {
+            const char* nl = memchr(&data[record_end], '\n', data_size - record_end);
+            record_end = nl != NULL ? (size_t)(nl - data) + 1 : data_size;
+        } while (record_end < data_size &&
+                 (data_size - record_end < KLOGGER_QUERY_LEVEL_STRING_LEN + 2 ||
+                  data[record_end] != '[' ||
+                  data[record_end + KLOGGER_QUERY_LEVEL_STRING_LEN + 1] != ']'));
+
+        const size_t record_size = record_end - record_start;
+        if (record_size > KLOGGER_QUERY_LEVEL_STRING_LEN + 2 &&
+            __klogger_query_match(query, &data[record_start], record_size, day_start))
+        {
+            fwrite(&data[record_start], 1, record_size, stdout);
+            ++matched;
+        }
+
+        record_start = record_end;
+    }
+
+    munmap(map, map_size);
+
+    return matched;
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option long_options[] = {
+        {"from",    required_argument, NULL, 'f'},
+        {"to",      required_argument, NULL, 't'},
+        {"level",   required_argument, NULL, 'l'},
+        {"source",  required_argument, NULL, 's'},
+        {"message", required_argument, NULL, 'm'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL,      0,                 NULL, 0}
+    };
+
+    KLogger_query query = {.from = INT64_MIN, .to = INT64_MAX, .levels = 0};
+    const char* from_str = NULL;
+    const char* to_str = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:t:l:s:m:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+            {
+                from_str = optarg;
+                break;
+            }
+            case 't':
+            {
+                to_str = optarg;
+                break;
+            }
+            case 'l':
+            {
+                const int level = __klogger_query_parse_level(optarg);
+                if (level == -1)
+                {
+                    fprintf(stderr, "klogger-query: unknown level %s\n", optarg);
+                    return 1;
+                }
+
+                query.levels |= 1u << level;
+                break;
+            }
+            case 's':
+            {
+                query.source = optarg;
+                query.source_len = strlen(optarg);
+                query.source_line = strchr(optarg, ':') != NULL;
+                break;
+            }
+            case 'm':
+            {
+                query.message = optarg;
+                query.message_len = strlen(optarg);
+                break;
+            }
+            case 'h':
+            {
+                __klogger_query_usage(argv[0]);
+                return 0;
+            }
+            default:
+            {
+                __klogger_query_usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        __klogger_query_usage(argv[0]);
+        return 1;
+    }
+
+    const char* const log_name = argv[optind];
+    if (query.levels == 0)
+        query.levels = (1u << (KLOGGER_LEVEL_MAX + 1)) - 1;
+
+    const int fd = open(log_name, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        perror("klogger-query: open error");
+        return 1;
+    }
+
+    KLogger_index_entry* entries = NULL;
+    ssize_t entries_num = __klogger_query_read_index(log_name, &entries);
+    if (entries_num < 0)
+    {
+        fprintf(stderr, "klogger-query: no index for %s, scanning whole file\n", log_name);
+        entries_num = 0;
+    }
+
+    /* HH:MM is relative to the day of first record, or today if there is no index */
+    const int64_t day_start = __klogger_query_day_start(entries_num > 0 ? entries[0].first_ts : (int64_t)time(NULL) * 1000000);
+    if ((from_str != NULL && __klogger_query_parse_time(from_str, day_start, &query.from) != 0) ||
+        (to_str != NULL && __klogger_query_parse_time(to_str, day_start, &query.to) != 0))
+    {
+        fprintf(stderr, "klogger-query: wrong time format\n");
+        return 1;
+    }
+
+    /* HH:MM:SS means the whole second */
+    if (to_str != NULL && to_str[0] != '@' && strchr(to_str, ':') != NULL)
+        query.to += strchr(strchr(to_str, ':') + 1, ':') != NULL ? 999999 : 60 * 1000000 - 1;
+
+    query.use_time = from_str != NULL || to_str != NULL;
+
+    /* The worst case: every block + not indexed tail */
+    KLogger_query_range* ranges = malloc(((size_t)entries_num + 1) * sizeof(*ranges));
+    if (ranges == NULL)
+    {
+        perror("klogger-query: malloc error");
+        return 1;
+    }
+
+    const size_t ranges_num = __klogger_query_select(&query, entries, (size_t)entries_num, (uint64_t)st.st_size, ranges);
+
+    size_t matched = 0;
+    for (size_t i = 0; i < ranges_num; ++i)
+        matched += __klogger_query_scan(&query, fd, &ranges[i], day_start);
+
+    free(ranges);
+    free(entries);
+    close(fd);
+
+    return matched > 0 ? 0 : 1;
+}